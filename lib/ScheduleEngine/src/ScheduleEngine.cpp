@@ -0,0 +1,996 @@
+#include "ScheduleEngine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef ARDUINO
+#include "esp_rom_crc.h"
+#endif
+
+// Compile-time math for the lookup table; no libm in constant expressions
+constexpr double constexprExp(double x)
+{
+  // Halve until the Taylor series converges quickly, then square back up
+  int halvings = 0;
+  while (x > 0.5 || x < -0.5)
+  {
+    x /= 2;
+    halvings++;
+  }
+  double sum = 1, term = 1;
+  for (int n = 1; n < 20; n++)
+  {
+    term *= x / n;
+    sum += term;
+  }
+  while (halvings-- > 0)
+  {
+    sum *= sum;
+  }
+  return sum;
+}
+
+constexpr double constexprLog(double x)
+{
+  // ln(x) = k ln 2 + 2 atanh((m - 1) / (m + 1)) with m in [0.5, 1)
+  const double LN2 = 0.69314718055994530942;
+  int k = 0;
+  while (x >= 1)
+  {
+    x /= 2;
+    k++;
+  }
+  while (x < 0.5)
+  {
+    x *= 2;
+    k--;
+  }
+  double y = (x - 1) / (x + 1), y2 = y * y, sum = 0, power = y;
+  for (int n = 1; n < 40; n += 2)
+  {
+    sum += power / n;
+    power *= y2;
+  }
+  return k * LN2 + 2 * sum;
+}
+
+constexpr double perceivedToLuminance(double lightness)
+{
+#ifdef LIGHT_GAMMA
+  // Plain power law, e.g. -DLIGHT_GAMMA=2.2
+  return lightness <= 0 ? 0 : constexprExp(LIGHT_GAMMA * constexprLog(lightness));
+#else
+  // CIE 1931 lightness L* (0-100) to relative luminance Y
+  double l = lightness * 100;
+  return l <= 8 ? l / 903.3 : ((l + 16) / 116) * ((l + 16) / 116) * ((l + 16) / 116);
+#endif
+}
+
+constexpr std::array<uint16_t, LUT_MAX + 1> buildPerceptualLut()
+{
+  std::array<uint16_t, LUT_MAX + 1> lut = {};
+  for (uint32_t i = 0; i <= LUT_MAX; i++)
+  {
+    lut[i] = (uint16_t)(perceivedToLuminance((double)i / LUT_MAX) * LEVEL_MAX + 0.5);
+  }
+  return lut;
+}
+
+constexpr std::array<uint16_t, LUT_MAX + 1> PERCEPTUAL_LUT_DATA = buildPerceptualLut();
+static_assert(PERCEPTUAL_LUT_DATA[0] == 0 && PERCEPTUAL_LUT_DATA[LUT_MAX] == LEVEL_MAX,
+              "Light curve must span the full range");
+const std::array<uint16_t, LUT_MAX + 1> PERCEPTUAL_LUT = PERCEPTUAL_LUT_DATA;
+
+struct Segment
+{
+  uint32_t start;
+  uint32_t end;
+  int32_t startDuty;
+  int32_t slope;
+};
+
+static SchedulePoint clampPoint(SchedulePoint point)
+{
+  point.time = std::min(point.time, SECONDS_PER_DAY);
+  point.duty = std::min(point.duty, (uint16_t)10000);
+  return point;
+}
+
+static Segment makeSegment(SchedulePoint before, SchedulePoint after)
+{
+  int32_t startLevel = (before.duty * LEVEL_MAX + 5000) / 10000;
+  int32_t endLevel = (after.duty * LEVEL_MAX + 5000) / 10000;
+  int64_t span = after.time - before.time;
+  int64_t rise = (int64_t)(endLevel - startLevel) << 12;
+
+  // Round the Q12 slope to nearest so the end of long segments stays within a level
+  return {before.time, after.time, startLevel, (int32_t)((rise + (rise >= 0 ? span / 2 : -span / 2)) / span)};
+}
+
+void compileChannel(ScheduleTable &table, std::vector<SchedulePoint> &points)
+{
+  // Stable, so of points sharing a time the one given last still wins
+  // when an edited list is compiled again
+  std::stable_sort(points.begin(), points.end(),
+                   [](const SchedulePoint &a, const SchedulePoint &b)
+                   { return a.time < b.time; });
+
+  // Implicit 0% points at 00:00 and 24:00 close the day
+  SchedulePoint before = {0, 0};
+  for (size_t i = 0; !points.empty() && i <= points.size(); i++)
+  {
+    SchedulePoint after = clampPoint((i < points.size()) ? points[i] : SchedulePoint{SECONDS_PER_DAY, 0});
+
+    // Points sharing a time produce no segment; the last one wins
+    if (after.time > before.time)
+    {
+      Segment segment = makeSegment(before, after);
+      table.start.push_back(segment.start);
+      table.end.push_back(segment.end);
+      table.startDuty.push_back(segment.startDuty);
+      table.slope.push_back(segment.slope);
+    }
+    before = after;
+  }
+}
+
+// Replaces column[at, at + removed) with a field of the new segments,
+// moving the tail at most once per column
+template <typename T, typename Field>
+static void spliceColumn(std::vector<T> &column, size_t at, size_t removed, const std::vector<Segment> &segments,
+                         Field field)
+{
+  size_t common = std::min(removed, segments.size());
+  for (size_t i = 0; i < common; i++)
+  {
+    column[at + i] = field(segments[i]);
+  }
+  if (removed > common)
+  {
+    column.erase(column.begin() + at + common, column.begin() + at + removed);
+  }
+  else if (segments.size() > common)
+  {
+    std::vector<T> added;
+    for (size_t i = common; i < segments.size(); i++)
+    {
+      added.push_back(field(segments[i]));
+    }
+    column.insert(column.begin() + at + common, added.begin(), added.end());
+  }
+}
+
+void recompileCurveWindow(ScheduleTable &table, int curve, const std::vector<SchedulePoint> &points, TimeWindow window)
+{
+  size_t first = table.first[curve];
+  size_t last = table.first[curve + 1];
+
+  // Old segments inside the window
+  size_t oldFirst = first;
+  size_t oldLast = last;
+  if (!points.empty())
+  {
+    oldFirst = std::lower_bound(table.start.begin() + first, table.start.begin() + last, window.from) -
+               table.start.begin();
+    oldLast = std::upper_bound(table.end.begin() + oldFirst, table.end.begin() + last, window.to) - table.end.begin();
+  }
+
+  // New ones, walked like compileChannel from the last point at window.from
+  std::vector<Segment> segments;
+  if (!points.empty() && window.from < window.to)
+  {
+    size_t i = std::upper_bound(points.begin(), points.end(), window.from,
+                                [](uint32_t second, const SchedulePoint &point)
+                                { return second < std::min(point.time, SECONDS_PER_DAY); }) -
+               points.begin();
+    SchedulePoint before = i > 0 ? clampPoint(points[i - 1]) : SchedulePoint{0, 0};
+    for (; i <= points.size(); i++)
+    {
+      SchedulePoint after = clampPoint((i < points.size()) ? points[i] : SchedulePoint{SECONDS_PER_DAY, 0});
+      if (after.time > before.time)
+      {
+        segments.push_back(makeSegment(before, after));
+      }
+      before = after;
+      if (after.time >= window.to)
+      {
+        break;
+      }
+    }
+  }
+
+  size_t removed = oldLast - oldFirst;
+  spliceColumn(table.start, oldFirst, removed, segments, [](const Segment &segment)
+               { return segment.start; });
+  spliceColumn(table.end, oldFirst, removed, segments, [](const Segment &segment)
+               { return segment.end; });
+  spliceColumn(table.startDuty, oldFirst, removed, segments, [](const Segment &segment)
+               { return segment.startDuty; });
+  spliceColumn(table.slope, oldFirst, removed, segments, [](const Segment &segment)
+               { return segment.slope; });
+  for (int c = curve + 1; c <= CURVE_COUNT; c++)
+  {
+    table.first[c] = table.first[c] + segments.size() - removed;
+  }
+}
+
+static uint32_t timeBefore(const std::vector<SchedulePoint> &points, size_t i)
+{
+  return i > 0 ? std::min(points[i - 1].time, SECONDS_PER_DAY) : 0;
+}
+
+static uint32_t timeFrom(const std::vector<SchedulePoint> &points, size_t i)
+{
+  return i < points.size() ? std::min(points[i].time, SECONDS_PER_DAY) : SECONDS_PER_DAY;
+}
+
+TimeWindow insertSchedulePoint(std::vector<SchedulePoint> &points, SchedulePoint point, size_t &index)
+{
+  // After any points at the same time, so the new one wins
+  index = std::upper_bound(points.begin(), points.end(), point,
+                           [](const SchedulePoint &a, const SchedulePoint &b)
+                           { return a.time < b.time; }) -
+          points.begin();
+  points.insert(points.begin() + index, point);
+  return {timeBefore(points, index), timeFrom(points, index + 1)};
+}
+
+TimeWindow removeSchedulePoint(std::vector<SchedulePoint> &points, size_t index)
+{
+  TimeWindow window = {timeBefore(points, index), timeFrom(points, index + 1)};
+  points.erase(points.begin() + index);
+  return window;
+}
+
+TimeWindow updateSchedulePoint(std::vector<SchedulePoint> &points, size_t &index, SchedulePoint point)
+{
+  TimeWindow removed = removeSchedulePoint(points, index);
+  TimeWindow inserted = insertSchedulePoint(points, point, index);
+  return {std::min(removed.from, inserted.from), std::max(removed.to, inserted.to)};
+}
+
+int profileForDay(const std::vector<ProfileRule> &rules, int day, int weekday)
+{
+  for (const ProfileRule &rule : rules)
+  {
+    bool inRange = rule.firstDay <= rule.lastDay ? day >= rule.firstDay && day <= rule.lastDay
+                                                 : day >= rule.firstDay || day <= rule.lastDay;
+    if (inRange && (rule.weekdays & (1 << weekday)))
+    {
+      return rule.profile;
+    }
+  }
+  return 0;
+}
+
+void compileScheduleTable(ScheduleTable &table, ProfilePoints &points, const std::vector<ProfileRule> &rules,
+                          std::vector<SchedulePoint> *solar)
+{
+  table.start.clear();
+  table.end.clear();
+  table.startDuty.clear();
+  table.slope.clear();
+  for (int profile = 0; profile < MAX_PROFILES; profile++)
+  {
+    for (int ch = 0; ch < PWM_CHANNEL_COUNT; ch++)
+    {
+      table.first[curveIndex(profile, ch)] = table.start.size();
+      bool sun = profile == 0 && solar != nullptr && !solar[ch].empty();
+      compileChannel(table, sun ? solar[ch] : points[profile][ch]);
+    }
+  }
+  table.first[CURVE_COUNT] = table.start.size();
+
+  for (int day = 0; day < CALENDAR_DAYS; day++)
+  {
+    for (int weekday = 0; weekday < 7; weekday++)
+    {
+      table.dayProfile[day][weekday] = profileForDay(rules, day, weekday);
+    }
+  }
+}
+
+size_t findSegment(const ScheduleTable &table, int curve, uint32_t second, size_t &cursor)
+{
+  size_t first = table.first[curve];
+  size_t last = table.first[curve + 1];
+  if (first == last)
+  {
+    return NO_SEGMENT;
+  }
+
+  // Fast path: time only moves forward between ticks, so the cursor is
+  // almost always still in the same segment or has just moved to the next one
+  for (size_t step = 0; step < 2; step++)
+  {
+    size_t i = (cursor + step < first || cursor + step >= last) ? first : cursor + step;
+    if (second >= table.start[i] && second < table.end[i])
+    {
+      cursor = i;
+      return i;
+    }
+  }
+
+  // Slow path: binary search for the first segment ending after the given time
+  auto begin = table.end.begin() + first;
+  auto it = std::upper_bound(begin, table.end.begin() + last, second);
+  cursor = std::min((size_t)(it - table.end.begin()), last - 1); // 24:00 exactly belongs to the last segment
+  return cursor;
+}
+
+uint32_t dutyAt(const ScheduleTable &table, size_t i, uint32_t second)
+{
+  // Q12 slope times elapsed seconds, rounded to the nearest level
+  int64_t delta = ((int64_t)table.slope[i] * (int32_t)(second - table.start[i]) + 0x800) >> 12;
+  return std::min(std::max(table.startDuty[i] + (int32_t)delta, (int32_t)0), (int32_t)LEVEL_MAX);
+}
+
+uint32_t calculateCurrentLevel(const ScheduleTable &table, int curve, uint32_t second, size_t &cursor)
+{
+  size_t i = findSegment(table, curve, second, cursor);
+  if (i == NO_SEGMENT)
+  {
+    return 0; // No schedule, lights off
+  }
+
+  return dutyAt(table, i, second);
+}
+
+uint32_t softwareFadeStep(uint32_t duty, uint32_t targetDuty)
+{
+  // Smooth fade
+  if (targetDuty > duty + FADE_STEP)
+  {
+    return duty + FADE_STEP;
+  }
+  if (targetDuty + FADE_STEP < duty)
+  {
+    return duty - FADE_STEP;
+  }
+  return targetDuty; // close enough
+}
+
+bool parseTimeOfDay(const char *text, uint32_t &second)
+{
+  // "HH:MM" or "HH:MM:SS", up to 24:00, with nothing left over
+  char *end;
+  long hours = strtol(text, &end, 10);
+  if (end == text || *end != ':' || hours < 0 || hours > 24)
+  {
+    return false;
+  }
+  const char *field = end + 1;
+  long minutes = strtol(field, &end, 10);
+  if (end == field)
+  {
+    return false;
+  }
+  long seconds = 0;
+  if (*end == ':')
+  {
+    field = end + 1;
+    seconds = strtol(field, &end, 10);
+    if (end == field)
+    {
+      return false;
+    }
+  }
+  if (*end != '\0' || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59)
+  {
+    return false;
+  }
+
+  second = hours * 3600 + minutes * 60 + seconds;
+  return second <= SECONDS_PER_DAY;
+}
+
+bool parseDutyPercent(const char *text, uint16_t &duty)
+{
+  // NaN would pass the clamp and make the conversion undefined
+  char *end;
+  float percent = strtof(text, &end);
+  if (end == text || *end != '\0' || !std::isfinite(percent))
+  {
+    return false;
+  }
+  duty = (uint16_t)(std::min(std::max(percent, 0.0f), 100.0f) * 100 + 0.5f);
+  return true;
+}
+
+SolarDay computeSolarDay(double latitude, double longitude, int dayOfYear, int daysInYear, int32_t utcOffset)
+{
+  const double DEG = M_PI / 180;
+  // Fractional year at noon, then the equation of time (minutes) and declination
+  double g = 2 * M_PI / daysInYear * dayOfYear;
+  double equationOfTime = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g) - 0.014615 * cos(2 * g) -
+                                    0.040849 * sin(2 * g));
+  SolarDay day;
+  day.latitude = latitude * DEG;
+  day.declination = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g) - 0.006758 * cos(2 * g) +
+                    0.000907 * sin(2 * g) - 0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+  day.noonUtc = 720 - 4 * longitude - equationOfTime;
+  day.utcOffset = utcOffset;
+  day.maxElevation = 90 - fabs(latitude - day.declination / DEG);
+
+  // Hour angle where the upper limb touches the horizon, refraction included
+  double cosHourAngle = cos(90.833 * DEG) / (cos(day.latitude) * cos(day.declination)) -
+                        tan(day.latitude) * tan(day.declination);
+  if (cosHourAngle <= -1 || cosHourAngle >= 1)
+  {
+    day.sunrise = day.sunset = NO_SUN;
+    return day;
+  }
+  double halfDayMinutes = 4 * acos(cosHourAngle) / DEG;
+  auto local = [&](double utcMinutes)
+  {
+    double second = fmod(utcMinutes * 60 + utcOffset, SECONDS_PER_DAY);
+    return (int32_t)(second < 0 ? second + SECONDS_PER_DAY : second);
+  };
+  day.sunrise = local(day.noonUtc - halfDayMinutes);
+  day.sunset = local(day.noonUtc + halfDayMinutes);
+  return day;
+}
+
+double solarElevation(const SolarDay &day, uint32_t second)
+{
+  const double DEG = M_PI / 180;
+  double utcMinutes = ((int32_t)second - day.utcOffset) / 60.0;
+  double hourAngle = (utcMinutes - day.noonUtc) / 4 * DEG;
+  double cosZenith = sin(day.latitude) * sin(day.declination) +
+                     cos(day.latitude) * cos(day.declination) * cos(hourAngle);
+  return 90 - acos(std::min(std::max(cosZenith, -1.0), 1.0)) / DEG;
+}
+
+void solarSchedule(const SolarDay &day, uint16_t peakDuty, std::vector<SchedulePoint> &points)
+{
+  // Irradiance goes with the sine of the elevation; scale it so solar noon
+  // reaches the peak duty. Sampled on a fixed grid plus the exact sunrise
+  // and sunset, so the table gets short segments only where the curve bends.
+  points.clear();
+  if (day.maxElevation <= 0 || peakDuty == 0)
+  {
+    points.push_back({0, 0}); // Polar night: off all day, yet never empty
+    return;
+  }
+
+  const double DEG = M_PI / 180;
+  double peak = sin(std::min(day.maxElevation, 90.0) * DEG);
+  auto sample = [&](uint32_t second)
+  {
+    double elevation = solarElevation(day, second);
+    double duty = elevation > 0 ? peakDuty * sin(elevation * DEG) / peak : 0;
+    points.push_back({second, (uint16_t)std::min(duty + 0.5, (double)peakDuty)});
+  };
+
+  for (uint32_t second = 0; second <= SECONDS_PER_DAY; second += SOLAR_STEP_S)
+  {
+    sample(second);
+  }
+  if (day.sunrise != NO_SUN)
+  {
+    points.push_back({(uint32_t)day.sunrise, 0});
+    points.push_back({(uint32_t)day.sunset, 0});
+  }
+  std::sort(points.begin(), points.end(),
+            [](const SchedulePoint &a, const SchedulePoint &b)
+            { return a.time < b.time; });
+  // Grid points at night add nothing; keep one on each side of the light
+  std::vector<SchedulePoint> kept;
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    bool dark = points[i].duty == 0 && (i == 0 || points[i - 1].duty == 0) &&
+                (i + 1 == points.size() || points[i + 1].duty == 0);
+    if (!dark || i == 0)
+    {
+      kept.push_back(points[i]);
+    }
+  }
+  points.swap(kept);
+}
+
+static bool isSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void ScheduleJsonParser::reset()
+{
+  points.clear();
+  error = nullptr;
+  state = EXPECT_ARRAY;
+}
+
+bool ScheduleJsonParser::feed(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len && error == nullptr; i++)
+  {
+    feedChar((char)data[i]);
+  }
+  return error == nullptr;
+}
+
+bool ScheduleJsonParser::finish()
+{
+  if (error == nullptr && state != DONE)
+  {
+    error = "Truncated schedule";
+  }
+  return error == nullptr;
+}
+
+void ScheduleJsonParser::appendToken(char c)
+{
+  // Longer tokens are never valid times, durations or known keys
+  if (tokenLen < sizeof(token) - 1)
+  {
+    token[tokenLen++] = c;
+  }
+}
+
+void ScheduleJsonParser::endKey()
+{
+  token[tokenLen] = '\0';
+  field = strcmp(token, "time") == 0 ? FIELD_TIME : strcmp(token, "duty") == 0 ? FIELD_DUTY
+                                                                                : FIELD_OTHER;
+}
+
+void ScheduleJsonParser::endValue()
+{
+  token[tokenLen] = '\0';
+  if (field == FIELD_TIME)
+  {
+    timeValid = parseTimeOfDay(token, time);
+  }
+  else if (field == FIELD_DUTY)
+  {
+    if (!parseDutyPercent(token, duty))
+    {
+      error = "Invalid duty";
+      return;
+    }
+  }
+  state = OBJECT_NEXT;
+}
+
+void ScheduleJsonParser::endObject()
+{
+  if (timeValid)
+  {
+    if (points.size() >= MAX_SCHEDULE_POINTS)
+    {
+      error = "Too many schedule points";
+      return;
+    }
+    points.push_back({time, duty});
+  }
+  state = ARRAY_NEXT;
+}
+
+void ScheduleJsonParser::feedChar(char c)
+{
+  switch (state)
+  {
+  case STRING_VALUE:
+    if (c == '\\')
+    {
+      state = STRING_ESCAPE;
+    }
+    else if (c == '"')
+    {
+      endValue();
+    }
+    else
+    {
+      appendToken(c);
+    }
+    return;
+  case STRING_ESCAPE:
+    appendToken(c); // Escapes never occur in valid times; keep the length honest
+    state = STRING_VALUE;
+    return;
+  case KEY:
+    if (c == '"')
+    {
+      endKey();
+      state = COLON;
+    }
+    else
+    {
+      appendToken(c);
+    }
+    return;
+  case BARE_VALUE:
+    // Numbers and true/false/null end at the next delimiter
+    if (isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.')
+    {
+      appendToken(c);
+      return;
+    }
+    endValue();
+    break; // The delimiter belongs to OBJECT_NEXT
+  default:
+    break;
+  }
+
+  if (isSpace(c))
+  {
+    return;
+  }
+
+  switch (state)
+  {
+  case EXPECT_ARRAY:
+    state = c == '[' ? ARRAY_FIRST : state;
+    error = c == '[' ? nullptr : "Schedule must be a JSON array";
+    break;
+  case ARRAY_FIRST:
+  case EXPECT_OBJECT:
+    if (c == ']' && state == ARRAY_FIRST)
+    {
+      state = DONE;
+    }
+    else if (c == '{')
+    {
+      timeValid = false;
+      duty = 0;
+      state = OBJECT_FIRST;
+    }
+    else
+    {
+      error = "Expected a schedule point object";
+    }
+    break;
+  case ARRAY_NEXT:
+    state = c == ',' ? EXPECT_OBJECT : c == ']' ? DONE
+                                                 : state;
+    error = (c == ',' || c == ']') ? nullptr : "Expected ',' or ']'";
+    break;
+  case OBJECT_FIRST:
+  case EXPECT_KEY:
+    if (c == '}' && state == OBJECT_FIRST)
+    {
+      endObject();
+    }
+    else if (c == '"')
+    {
+      tokenLen = 0;
+      state = KEY;
+    }
+    else
+    {
+      error = "Expected a key";
+    }
+    break;
+  case OBJECT_NEXT:
+    if (c == ',')
+    {
+      state = EXPECT_KEY;
+    }
+    else if (c == '}')
+    {
+      endObject();
+    }
+    else
+    {
+      error = "Expected ',' or '}'";
+    }
+    break;
+  case COLON:
+    state = c == ':' ? VALUE : state;
+    error = c == ':' ? nullptr : "Expected ':'";
+    break;
+  case VALUE:
+    tokenLen = 0;
+    if (c == '"')
+    {
+      state = STRING_VALUE;
+    }
+    else if (isalnum((unsigned char)c) || c == '-' || c == '.')
+    {
+      appendToken(c);
+      state = BARE_VALUE;
+    }
+    else
+    {
+      error = "Unsupported value"; // Nested arrays and objects
+    }
+    break;
+  case DONE:
+    error = "Unexpected data after schedule";
+    break;
+  default:
+    break;
+  }
+}
+
+void ScheduleBlobParser::reset()
+{
+  points.clear();
+  error = nullptr;
+  received = 0;
+  crc = 0;
+}
+
+bool ScheduleBlobParser::feed(const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len && error == nullptr; i++)
+  {
+    if (received < sizeof(header))
+    {
+      ((uint8_t *)&header)[received++] = data[i];
+      if (received == sizeof(header) && !validHeader())
+      {
+        error = "Bad schedule header";
+      }
+      continue;
+    }
+
+    // Once the header is complete, consume whole words straight from the chunk
+    size_t offset = (received - sizeof(header)) % sizeof(uint32_t);
+    word[offset] = data[i];
+    received++;
+    if (offset == sizeof(uint32_t) - 1)
+    {
+      if (points.size() >= header.count)
+      {
+        error = "Unexpected data after schedule";
+        break;
+      }
+      crc = scheduleCrc32(crc, word, sizeof(word));
+      uint32_t packed;
+      memcpy(&packed, word, sizeof(packed));
+      points.push_back({std::min(packed & 0x1FFFF, SECONDS_PER_DAY), std::min((uint16_t)(packed >> 17), (uint16_t)10000)});
+    }
+  }
+  return error == nullptr;
+}
+
+bool ScheduleBlobParser::finish()
+{
+  if (error == nullptr && (received < sizeof(header) || points.size() != header.count))
+  {
+    error = "Truncated schedule";
+  }
+  else if (error == nullptr && crc != header.crc)
+  {
+    error = "Schedule CRC mismatch";
+  }
+  return error == nullptr;
+}
+
+bool ScheduleBlobParser::validHeader()
+{
+  if (header.magic != SCHEDULE_BLOB_MAGIC || header.version != SCHEDULE_BLOB_VERSION ||
+      header.count > MAX_SCHEDULE_POINTS)
+  {
+    return false;
+  }
+  points.reserve(header.count);
+  return true;
+}
+
+uint32_t scheduleCrc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+#ifdef ARDUINO
+  return esp_rom_crc32_le(crc, data, len);
+#else
+  // Bitwise, reflected polynomial; only the host builds take this path
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+#endif
+}
+
+std::vector<uint8_t> encodeScheduleBlob(const std::vector<SchedulePoint> &points)
+{
+  // Versioned blob: header, then one packed 32-bit word per point
+  // The words start at offset 10, so they are copied rather than stored through a pointer
+  std::vector<uint8_t> blob(sizeof(ScheduleBlobHeader) + points.size() * sizeof(uint32_t));
+  uint8_t *packed = blob.data() + sizeof(ScheduleBlobHeader);
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    uint32_t word = points[i].time | ((uint32_t)points[i].duty << 17);
+    memcpy(packed + i * sizeof(word), &word, sizeof(word));
+  }
+
+  ScheduleBlobHeader header = {SCHEDULE_BLOB_MAGIC, SCHEDULE_BLOB_VERSION, 0, (uint16_t)points.size(),
+                               scheduleCrc32(0, packed, points.size() * sizeof(uint32_t))};
+  memcpy(blob.data(), &header, sizeof(header));
+  return blob;
+}
+
+bool decodeScheduleBlob(const uint8_t *blob, size_t length, std::vector<SchedulePoint> &points)
+{
+  if (length < sizeof(ScheduleBlobHeader))
+  {
+    return false;
+  }
+
+  ScheduleBlobHeader header;
+  memcpy(&header, blob, sizeof(header));
+  const uint8_t *packed = blob + sizeof(header);
+  if (header.magic != SCHEDULE_BLOB_MAGIC || header.version != SCHEDULE_BLOB_VERSION ||
+      header.count > MAX_SCHEDULE_POINTS || length != sizeof(header) + header.count * sizeof(uint32_t) ||
+      header.crc != scheduleCrc32(0, packed, header.count * sizeof(uint32_t)))
+  {
+    return false;
+  }
+
+  points.resize(header.count);
+  for (size_t i = 0; i < header.count; i++)
+  {
+    uint32_t word;
+    memcpy(&word, packed + i * sizeof(word), sizeof(word));
+    points[i] = {word & 0x1FFFF, (uint16_t)(word >> 17)};
+  }
+  return true;
+}
+
+void scheduleToJson(const std::vector<SchedulePoint> &points, JsonArray array)
+{
+  for (const SchedulePoint &point : points)
+  {
+    char timeStr[16]; // Fits any uint32_t time, not just those of one day
+    if (point.time % 60 == 0)
+    {
+      snprintf(timeStr, sizeof(timeStr), "%02u:%02u", (unsigned)(point.time / 3600), (unsigned)(point.time / 60 % 60));
+    }
+    else
+    {
+      snprintf(timeStr, sizeof(timeStr), "%02u:%02u:%02u", (unsigned)(point.time / 3600), (unsigned)(point.time / 60 % 60),
+               (unsigned)(point.time % 60));
+    }
+
+    JsonObject obj = array.add<JsonObject>();
+    obj["time"] = timeStr;
+    obj["duty"] = point.duty / 100.0;
+  }
+}
+
+std::vector<uint8_t> encodeProfileRules(const std::vector<ProfileRule> &rules)
+{
+  size_t size = rules.size() * sizeof(ProfileRule);
+  std::vector<uint8_t> blob(sizeof(ScheduleBlobHeader) + size);
+  if (size)
+  {
+    memcpy(blob.data() + sizeof(ScheduleBlobHeader), rules.data(), size);
+  }
+
+  ScheduleBlobHeader header = {PROFILE_RULES_MAGIC, SCHEDULE_BLOB_VERSION, 0, (uint16_t)rules.size(),
+                               scheduleCrc32(0, blob.data() + sizeof(ScheduleBlobHeader), size)};
+  memcpy(blob.data(), &header, sizeof(header));
+  return blob;
+}
+
+bool decodeProfileRules(const uint8_t *blob, size_t length, std::vector<ProfileRule> &rules)
+{
+  if (length < sizeof(ScheduleBlobHeader))
+  {
+    return false;
+  }
+
+  ScheduleBlobHeader header;
+  memcpy(&header, blob, sizeof(header));
+  const uint8_t *data = blob + sizeof(header);
+  if (header.magic != PROFILE_RULES_MAGIC || header.version != SCHEDULE_BLOB_VERSION ||
+      header.count > MAX_PROFILE_RULES || length != sizeof(header) + header.count * sizeof(ProfileRule) ||
+      header.crc != scheduleCrc32(0, data, header.count * sizeof(ProfileRule)))
+  {
+    return false;
+  }
+
+  std::vector<ProfileRule> decoded(header.count);
+  memcpy(decoded.data(), data, header.count * sizeof(ProfileRule));
+  for (const ProfileRule &rule : decoded)
+  {
+    if (rule.profile >= MAX_PROFILES || rule.firstDay >= CALENDAR_DAYS || rule.lastDay >= CALENDAR_DAYS)
+    {
+      return false;
+    }
+  }
+  rules.swap(decoded);
+  return true;
+}
+
+static bool parseCalendarDay(const char *text, uint16_t &day)
+{
+  // "MM-DD"
+  char *end;
+  long month = strtol(text, &end, 10);
+  if (end == text || *end != '-')
+  {
+    return false;
+  }
+  long mday = strtol(end + 1, &end, 10);
+  if (*end != '\0' || month < 1 || month > 12 || mday < 1 || mday > 31)
+  {
+    return false;
+  }
+  day = calendarDay(month - 1, mday);
+  return true;
+}
+
+void profileRulesToJson(const std::vector<ProfileRule> &rules, JsonArray array)
+{
+  for (const ProfileRule &rule : rules)
+  {
+    JsonObject obj = array.add<JsonObject>();
+    obj["profile"] = rule.profile;
+    JsonArray weekdays = obj["weekdays"].to<JsonArray>();
+    for (int weekday = 0; weekday < 7; weekday++)
+    {
+      if (rule.weekdays & (1 << weekday))
+      {
+        weekdays.add(weekday);
+      }
+    }
+    char date[8];
+    snprintf(date, sizeof(date), "%02u-%02u", (unsigned)(rule.firstDay / 31 + 1), (unsigned)(rule.firstDay % 31 + 1));
+    obj["from"] = date;
+    snprintf(date, sizeof(date), "%02u-%02u", (unsigned)(rule.lastDay / 31 + 1), (unsigned)(rule.lastDay % 31 + 1));
+    obj["to"] = date;
+  }
+}
+
+const char *profileRulesFromJson(JsonArrayConst array, std::vector<ProfileRule> &rules)
+{
+  if (array.isNull())
+  {
+    return "Rules must be a JSON array";
+  }
+  if (array.size() > MAX_PROFILE_RULES)
+  {
+    return "Too many profile rules";
+  }
+
+  std::vector<ProfileRule> parsed;
+  for (JsonObjectConst obj : array)
+  {
+    ProfileRule rule = {0, ALL_WEEKDAYS, 0, CALENDAR_DAYS - 1};
+    int profile = obj["profile"] | -1;
+    if (profile < 0 || profile >= MAX_PROFILES)
+    {
+      return "Invalid profile";
+    }
+    rule.profile = profile;
+
+    if (obj["weekdays"].is<JsonArrayConst>())
+    {
+      rule.weekdays = 0;
+      for (JsonVariantConst weekday : obj["weekdays"].as<JsonArrayConst>())
+      {
+        int value = weekday | -1;
+        if (value < 0 || value > 6)
+        {
+          return "Weekdays run from 0 (Sunday) to 6";
+        }
+        rule.weekdays |= 1 << value;
+      }
+    }
+
+    const char *from = obj["from"] | (const char *)nullptr;
+    const char *to = obj["to"] | (const char *)nullptr;
+    if ((from != nullptr) != (to != nullptr))
+    {
+      return "Date ranges need both from and to";
+    }
+    if (from != nullptr && (!parseCalendarDay(from, rule.firstDay) || !parseCalendarDay(to, rule.lastDay)))
+    {
+      return "Dates must be MM-DD";
+    }
+    parsed.push_back(rule);
+  }
+
+  rules.swap(parsed);
+  return nullptr;
+}
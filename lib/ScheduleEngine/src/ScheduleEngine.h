@@ -0,0 +1,265 @@
+#pragma once
+
+// Schedule engine: compiled schedule tables, interpolation, fades and the
+// schedule formats. Free of Arduino and IDF dependencies so the native
+// environment can build, test and benchmark it on the host.
+
+#include <ArduinoJson.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+const int PWM_CHANNEL_COUNT = 6; // All LEDC channels of the C3
+
+// The engine works in 16-bit brightness levels whatever the LEDC runs, and
+// the firmware converts to duty register units only when writing the output
+const uint8_t LEVEL_BITS = 16;
+const uint32_t LEVEL_MAX = (1 << LEVEL_BITS) - 1;
+const uint32_t FADE_STEP = LEVEL_MAX / 500; // max change per update in levels, ~0.2% (adjust for smoothness)
+
+const uint32_t SECONDS_PER_DAY = 24 * 3600;
+const size_t NO_SEGMENT = SIZE_MAX;
+
+// Top 12 bits of a perceived level to an output level, built by the compiler into flash
+const uint8_t LUT_BITS = 12;
+const uint32_t LUT_MAX = (1 << LUT_BITS) - 1;
+extern const std::array<uint16_t, LUT_MAX + 1> PERCEPTUAL_LUT;
+
+struct SchedulePoint
+{
+  uint32_t time; // Time in seconds of day (0-86400)
+  uint16_t duty; // Duty cycle in 0.01% steps (0-10000)
+};
+
+const size_t MAX_SCHEDULE_POINTS = 1000; // Per channel
+
+// NVS schedule format: this header followed by one word per point,
+// time in bits 0-16 and duty in bits 17-30. The CRC covers the points.
+struct ScheduleBlobHeader
+{
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint16_t count;
+  uint32_t crc;
+} __attribute__((packed));
+
+const uint16_t SCHEDULE_BLOB_MAGIC = 0x5441; // "AT"
+const uint8_t SCHEDULE_BLOB_VERSION = 1;
+
+// Profiles: each is a full set of channel curves. Profile 0 is the
+// everyday program; rules pick another one by weekday and date range.
+const int MAX_PROFILES = 8;
+const size_t MAX_PROFILE_RULES = 16;
+const int CURVE_COUNT = MAX_PROFILES * PWM_CHANNEL_COUNT;
+
+// Calendar days are month * 31 + day - 1, so every date, 29 February
+// included, has the same index in every year
+const int CALENDAR_DAYS = 12 * 31;
+
+// Rules are checked in order and the first match wins. The date range is
+// inclusive and wraps over the new year when firstDay > lastDay.
+struct ProfileRule
+{
+  uint8_t profile;
+  uint8_t weekdays; // Bit 0 = Sunday, as tm_wday
+  uint16_t firstDay;
+  uint16_t lastDay;
+};
+static_assert(sizeof(ProfileRule) == 6, "Profile rules are stored in NVS as is");
+
+const uint8_t ALL_WEEKDAYS = 0x7F;
+const uint16_t PROFILE_RULES_MAGIC = 0x5052; // "PR", same header as schedule blobs
+
+// Compiled schedule: one linear segment per interval between consecutive
+// points, covering the whole day, for every channel. Stored as a
+// structure of arrays so one tick walks all channels over dense columns.
+// Curve c (see curveIndex) owns segments [first[c], first[c + 1]).
+// The profile of every calendar day and weekday is resolved at compile
+// time, so a lookup never evaluates rules.
+struct ScheduleTable
+{
+  std::vector<uint32_t> start;    // Segment start in seconds of day
+  std::vector<uint32_t> end;      // Segment end in seconds of day
+  std::vector<int32_t> startDuty; // Level at segment start
+  std::vector<int32_t> slope;     // Level change per second, Q12 fixed point
+  size_t first[CURVE_COUNT + 1] = {};
+  uint8_t dayProfile[CALENDAR_DAYS][7] = {};
+};
+
+// Point lists of every profile and channel
+typedef std::vector<SchedulePoint> ProfilePoints[MAX_PROFILES][PWM_CHANNEL_COUNT];
+
+inline int curveIndex(int profile, int channel)
+{
+  return profile * PWM_CHANNEL_COUNT + channel;
+}
+
+inline int calendarDay(int month, int day)
+{
+  return month * 31 + day - 1; // tm_mon and tm_mday
+}
+
+// Sorts the points and appends the curve's segments to the table
+void compileChannel(ScheduleTable &table, std::vector<SchedulePoint> &points);
+// Rebuilds the whole table from the point lists and the profile rules.
+// Non-empty solar[ch] lists replace the everyday profile's points.
+void compileScheduleTable(ScheduleTable &table, ProfilePoints &points, const std::vector<ProfileRule> &rules,
+                          std::vector<SchedulePoint> *solar = nullptr);
+int profileForDay(const std::vector<ProfileRule> &rules, int day, int weekday);
+
+// Single point edits of a sorted point list. Each returns the times of the
+// unchanged points around the edit; only segments between them change.
+struct TimeWindow
+{
+  uint32_t from;
+  uint32_t to;
+};
+
+TimeWindow insertSchedulePoint(std::vector<SchedulePoint> &points, SchedulePoint point, size_t &index);
+TimeWindow updateSchedulePoint(std::vector<SchedulePoint> &points, size_t &index, SchedulePoint point);
+TimeWindow removeSchedulePoint(std::vector<SchedulePoint> &points, size_t index);
+// Brings a compiled curve up to date with its edited points by rebuilding
+// only the segments inside the window; everything after it just moves
+void recompileCurveWindow(ScheduleTable &table, int curve, const std::vector<SchedulePoint> &points, TimeWindow window);
+
+inline uint32_t secondOfDay(const struct tm &local)
+{
+  return local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+}
+
+// Profile in effect at a local time; a single table lookup
+inline int activeProfile(const ScheduleTable &table, const struct tm &local)
+{
+  return table.dayProfile[calendarDay(local.tm_mon, local.tm_mday)][local.tm_wday];
+}
+
+// Segment of a curve covering the given second, or NO_SEGMENT for an
+// empty curve. The cursor remembers the last hit and makes forward lookups O(1).
+size_t findSegment(const ScheduleTable &table, int curve, uint32_t second, size_t &cursor);
+uint32_t dutyAt(const ScheduleTable &table, size_t i, uint32_t second);
+uint32_t calculateCurrentLevel(const ScheduleTable &table, int curve, uint32_t second, size_t &cursor);
+uint32_t softwareFadeStep(uint32_t duty, uint32_t targetDuty);
+
+bool parseTimeOfDay(const char *text, uint32_t &second);
+// Duty in percent to 0.01% steps, clamped to 0-100. The whole text must be
+// a finite number, so typos and "nan" fail instead of reading as 0.
+bool parseDutyPercent(const char *text, uint16_t &duty);
+
+// Sun position for one day (NOAA approximation). Times are local seconds
+// of day; sunrise and sunset are NO_SUN when the sun never crosses the
+// horizon, with maxElevation telling polar day from polar night.
+struct SolarDay
+{
+  double latitude;    // Radians
+  double declination; // Radians
+  double noonUtc;     // Solar noon, minutes after UTC midnight
+  int32_t utcOffset;  // Local time minus UTC, seconds
+  int32_t sunrise;
+  int32_t sunset;
+  double maxElevation; // Degrees
+};
+
+const int32_t NO_SUN = -1;
+const uint32_t SOLAR_STEP_S = 600; // Sampling interval of the solar curve
+
+SolarDay computeSolarDay(double latitude, double longitude, int dayOfYear, int daysInYear, int32_t utcOffset);
+double solarElevation(const SolarDay &day, uint32_t second); // Degrees at a local second of day
+// Duty following the sun's elevation, peakDuty (0.01%) at solar noon
+void solarSchedule(const SolarDay &day, uint16_t peakDuty, std::vector<SchedulePoint> &points);
+
+// Incremental parser for JSON schedules of the form
+// [{"time":"HH:MM","duty":50}, ...]. Input can be fed in arbitrary chunks
+// as it arrives; only the current token and the parsed points are kept.
+// Unknown keys with scalar values are ignored, points with a missing or
+// invalid time are skipped and a missing duty reads as 0; a duty that is
+// not a finite number fails the whole schedule.
+class ScheduleJsonParser
+{
+public:
+  std::vector<SchedulePoint> points;
+  const char *error = nullptr;
+
+  void reset();
+  bool feed(const uint8_t *data, size_t len);
+  bool finish();
+
+private:
+  enum State
+  {
+    EXPECT_ARRAY,
+    ARRAY_FIRST,
+    ARRAY_NEXT,
+    EXPECT_OBJECT,
+    OBJECT_FIRST,
+    OBJECT_NEXT,
+    EXPECT_KEY,
+    KEY,
+    COLON,
+    VALUE,
+    STRING_VALUE,
+    STRING_ESCAPE,
+    BARE_VALUE,
+    DONE
+  };
+  enum Field
+  {
+    FIELD_OTHER,
+    FIELD_TIME,
+    FIELD_DUTY
+  };
+
+  State state = EXPECT_ARRAY;
+  Field field = FIELD_OTHER;
+  char token[16];
+  size_t tokenLen = 0;
+  bool timeValid = false;
+  uint32_t time = 0;
+  uint16_t duty = 0;
+
+  void appendToken(char c);
+  void endKey();
+  void endValue();
+  void endObject();
+  void feedChar(char c);
+};
+
+// Incremental parser for the binary schedule format stored in NVS
+// (ScheduleBlobHeader followed by packed points).
+class ScheduleBlobParser
+{
+public:
+  std::vector<SchedulePoint> points;
+  const char *error = nullptr;
+
+  void reset();
+  bool feed(const uint8_t *data, size_t len);
+  bool finish();
+
+private:
+  ScheduleBlobHeader header;
+  size_t received = 0;
+  uint8_t word[4];
+  uint32_t crc = 0;
+
+  bool validHeader();
+};
+
+// Zlib-compatible CRC-32, as the ESP32 ROM computes it
+uint32_t scheduleCrc32(uint32_t crc, const uint8_t *data, size_t len);
+
+std::vector<uint8_t> encodeScheduleBlob(const std::vector<SchedulePoint> &points);
+// Fails on bad magic, version, length or CRC and leaves points untouched
+bool decodeScheduleBlob(const uint8_t *blob, size_t length, std::vector<SchedulePoint> &points);
+
+void scheduleToJson(const std::vector<SchedulePoint> &points, JsonArray array);
+
+std::vector<uint8_t> encodeProfileRules(const std::vector<ProfileRule> &rules);
+bool decodeProfileRules(const uint8_t *blob, size_t length, std::vector<ProfileRule> &rules);
+
+// Rules as [{"profile":1,"weekdays":[0,6],"from":"12-24","to":"01-02"}, ...];
+// weekdays and the date range are optional and default to always
+void profileRulesToJson(const std::vector<ProfileRule> &rules, JsonArray array);
+const char *profileRulesFromJson(JsonArrayConst array, std::vector<ProfileRule> &rules); // Error or nullptr
@@ -0,0 +1,60 @@
+# Pre-build step: gzip the dashboard files in web/ and embed them as
+# PROGMEM arrays in include/web_assets.h, each with an ETag derived from
+# its contents. "__<SYMBOL>_VERSION__" in a later asset is replaced by an
+# earlier asset's hash so it can be served with a long-lived cache. The
+# header is only rewritten when something changes.
+Import("env")
+
+import gzip
+import hashlib
+import os
+
+PROJECT_DIR = env.subst("$PROJECT_DIR")
+ASSETS = [
+    # (source file, C symbol prefix), dependencies first
+    ("web/chart.js", "CHART_JS"),
+    ("web/index.html", "INDEX_HTML"),
+]
+OUTPUT = os.path.join(PROJECT_DIR, "include", "web_assets.h")
+
+
+versions = {}
+
+
+def embed(path, symbol):
+    with open(os.path.join(PROJECT_DIR, path), "rb") as f:
+        data = f.read()
+    for name, version in versions.items():
+        data = data.replace(("__%s_VERSION__" % name).encode(), version.encode())
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    etag = hashlib.sha256(data).hexdigest()[:16]
+    versions[symbol] = etag
+
+    lines = ["// %s: %d bytes, %d gzipped" % (path, len(data), len(packed))]
+    lines.append('const char %s_ETAG[] = "\\"%s\\"";' % (symbol, etag))
+    lines.append("const size_t %s_GZ_LEN = %d;" % (symbol, len(packed)))
+    lines.append("const uint8_t %s_GZ[] PROGMEM = {" % symbol)
+    for i in range(0, len(packed), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in packed[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+content = "\n".join([
+    "// Generated by scripts/embed_web.py from web/ - do not edit",
+    "#pragma once",
+    "",
+    "#include <Arduino.h>",
+    "",
+    "\n\n".join(embed(path, symbol) for path, symbol in ASSETS),
+    "",
+])
+
+current = None
+if os.path.exists(OUTPUT):
+    with open(OUTPUT) as f:
+        current = f.read()
+if content != current:
+    with open(OUTPUT, "w") as f:
+        f.write(content)
+    print("embed_web: regenerated %s" % os.path.relpath(OUTPUT, PROJECT_DIR))
@@ -0,0 +1,486 @@
+// Host tests and microbenchmarks for the schedule engine:
+//   pio test -e native -v
+// The benchmarks print their figures and only fail if the engine breaks.
+
+#include <ScheduleEngine.h>
+#include <unity.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+static volatile uint32_t sink; // Keeps benchmarked results observable
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::vector<SchedulePoint> makePoints(size_t count)
+{
+  // Evenly spread over the day with a sawtooth of duties
+  std::vector<SchedulePoint> points;
+  for (size_t i = 0; i < count; i++)
+  {
+    points.push_back({(uint32_t)((i + 1) * (SECONDS_PER_DAY - 1) / (count + 1)), (uint16_t)(i % 2 ? 2500 : 10000)});
+  }
+  return points;
+}
+
+static void compileOnChannel0(ScheduleTable &table, std::vector<SchedulePoint> points)
+{
+  static ProfilePoints profiles;
+  profiles[0][0] = points;
+  compileScheduleTable(table, profiles, {});
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_interpolates_between_points()
+{
+  ScheduleTable table;
+  compileOnChannel0(table, {{8 * 3600, 10000}, {6 * 3600, 0}, {20 * 3600, 0}});
+
+  size_t cursor = 0;
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, 0, 3 * 3600, cursor));
+  TEST_ASSERT_UINT32_WITHIN(1, LEVEL_MAX / 2, calculateCurrentLevel(table, 0, 7 * 3600, cursor));
+  TEST_ASSERT_EQUAL_UINT32(LEVEL_MAX, calculateCurrentLevel(table, 0, 8 * 3600, cursor));
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, 0, SECONDS_PER_DAY, cursor));
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, 1, 8 * 3600, cursor)); // Empty channel
+}
+
+void test_cursor_agrees_with_search()
+{
+  ScheduleTable table;
+  compileOnChannel0(table, makePoints(100));
+
+  size_t cursor = 0;
+  for (uint32_t second = 0; second <= SECONDS_PER_DAY; second += 7)
+  {
+    size_t fresh = 0;
+    TEST_ASSERT_EQUAL(findSegment(table, 0, second, fresh), findSegment(table, 0, second, cursor));
+  }
+}
+
+void test_profile_rules()
+{
+  static ProfilePoints profiles;
+  profiles[0][0] = {{12 * 3600, 5000}};
+  profiles[1][0] = {{12 * 3600, 10000}};
+  profiles[2][0] = {};
+  std::vector<ProfileRule> rules = {
+      {2, ALL_WEEKDAYS, (uint16_t)calendarDay(11, 24), (uint16_t)calendarDay(0, 2)}, // Holidays, over the new year
+      {1, (1 << 0) | (1 << 6), 0, CALENDAR_DAYS - 1},                              // Weekends
+  };
+  ScheduleTable table;
+  compileScheduleTable(table, profiles, rules);
+
+  struct tm saturday = {};
+  saturday.tm_mon = 5;
+  saturday.tm_mday = 15;
+  saturday.tm_wday = 6;
+  struct tm monday = saturday;
+  monday.tm_wday = 1;
+  struct tm newYear = saturday;
+  newYear.tm_mon = 0;
+  newYear.tm_mday = 1;
+  TEST_ASSERT_EQUAL(1, activeProfile(table, saturday));
+  TEST_ASSERT_EQUAL(0, activeProfile(table, monday));
+  TEST_ASSERT_EQUAL(2, activeProfile(table, newYear));
+
+  size_t cursor = 0;
+  TEST_ASSERT_EQUAL_UINT32(LEVEL_MAX, calculateCurrentLevel(table, curveIndex(1, 0), 12 * 3600, cursor));
+  TEST_ASSERT_EQUAL_UINT32(LEVEL_MAX / 2 + 1, calculateCurrentLevel(table, curveIndex(0, 0), 12 * 3600, cursor));
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, curveIndex(2, 0), 12 * 3600, cursor));
+
+  std::vector<uint8_t> blob = encodeProfileRules(rules);
+  std::vector<ProfileRule> decoded;
+  TEST_ASSERT_TRUE(decodeProfileRules(blob.data(), blob.size(), decoded));
+  TEST_ASSERT_EQUAL(rules.size(), decoded.size());
+  TEST_ASSERT_EQUAL_UINT16(rules[0].lastDay, decoded[0].lastDay);
+}
+
+void test_profile_rules_json()
+{
+  JsonDocument doc;
+  deserializeJson(doc, "[{\"profile\":1,\"weekdays\":[0,6]},{\"profile\":2,\"from\":\"12-24\",\"to\":\"01-02\"}]");
+  std::vector<ProfileRule> rules;
+  TEST_ASSERT_NULL(profileRulesFromJson(doc.as<JsonArrayConst>(), rules));
+  TEST_ASSERT_EQUAL(2, rules.size());
+  TEST_ASSERT_EQUAL_UINT8(0x41, rules[0].weekdays);
+  TEST_ASSERT_EQUAL_UINT16(calendarDay(11, 24), rules[1].firstDay);
+
+  JsonDocument out;
+  profileRulesToJson(rules, out.to<JsonArray>());
+  std::string json;
+  serializeJson(out, json);
+  TEST_ASSERT_EQUAL_STRING("[{\"profile\":1,\"weekdays\":[0,6],\"from\":\"01-01\",\"to\":\"12-31\"},"
+                           "{\"profile\":2,\"weekdays\":[0,1,2,3,4,5,6],\"from\":\"12-24\",\"to\":\"01-02\"}]",
+                           json.c_str());
+
+  deserializeJson(doc, "[{\"profile\":9}]");
+  TEST_ASSERT_NOT_NULL(profileRulesFromJson(doc.as<JsonArrayConst>(), rules));
+  deserializeJson(doc, "[{\"profile\":1,\"from\":\"13-01\",\"to\":\"01-01\"}]");
+  TEST_ASSERT_NOT_NULL(profileRulesFromJson(doc.as<JsonArrayConst>(), rules));
+  TEST_ASSERT_EQUAL(2, rules.size()); // Untouched by a failed parse
+}
+
+void test_solar_day()
+{
+  // Berlin on 2024-06-21, CEST: sunrise 04:43, sunset 21:33
+  SolarDay day = computeSolarDay(52.52, 13.40, 172, 366, 7200);
+  TEST_ASSERT_INT32_WITHIN(180, 4 * 3600 + 43 * 60, day.sunrise);
+  TEST_ASSERT_INT32_WITHIN(180, 21 * 3600 + 33 * 60, day.sunset);
+
+  std::vector<SchedulePoint> points;
+  solarSchedule(day, 10000, points);
+  ScheduleTable table;
+  compileOnChannel0(table, points);
+  size_t cursor = 0;
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, 0, day.sunrise - 600, cursor));
+  TEST_ASSERT_EQUAL_UINT32(0, calculateCurrentLevel(table, 0, day.sunset + 600, cursor));
+  uint32_t noon = (day.sunrise + day.sunset) / 2;
+  TEST_ASSERT_UINT32_WITHIN(LEVEL_MAX / 100, LEVEL_MAX, calculateCurrentLevel(table, 0, noon, cursor));
+  TEST_ASSERT_TRUE(points.size() <= SECONDS_PER_DAY / SOLAR_STEP_S + 3);
+
+  // Tromso at the winter solstice: polar night
+  day = computeSolarDay(69.65, 18.96, 355, 366, 3600);
+  TEST_ASSERT_EQUAL(NO_SUN, day.sunrise);
+  solarSchedule(day, 10000, points);
+  TEST_ASSERT_EQUAL(1, points.size());
+  TEST_ASSERT_EQUAL_UINT16(0, points[0].duty);
+}
+
+void test_point_edits_match_full_compile()
+{
+  // Coarse times so edits often land on or next to points sharing a time
+  static ProfilePoints profiles;
+  ScheduleTable table;
+  compileScheduleTable(table, profiles, {});
+  std::mt19937 random(7);
+  const int curves[] = {curveIndex(0, 0), curveIndex(1, 2), curveIndex(MAX_PROFILES - 1, PWM_CHANNEL_COUNT - 1)};
+  for (int edit = 0; edit < 3000; edit++)
+  {
+    int curve = curves[random() % 3];
+    std::vector<SchedulePoint> &points = profiles[curve / PWM_CHANNEL_COUNT][curve % PWM_CHANNEL_COUNT];
+    SchedulePoint point = {(uint32_t)(random() % 25) * 3600, (uint16_t)(random() % 10001)};
+    size_t index = points.empty() ? 0 : random() % points.size();
+    TimeWindow window;
+    int action = points.empty() ? 0 : random() % 3;
+    if (action == 0)
+    {
+      window = insertSchedulePoint(points, point, index);
+    }
+    else if (action == 1)
+    {
+      window = updateSchedulePoint(points, index, point);
+    }
+    else
+    {
+      window = removeSchedulePoint(points, index);
+    }
+    recompileCurveWindow(table, curve, points, window);
+
+    ScheduleTable expected;
+    compileScheduleTable(expected, profiles, {});
+    TEST_ASSERT_TRUE(table.start == expected.start);
+    TEST_ASSERT_TRUE(table.end == expected.end);
+    TEST_ASSERT_TRUE(table.startDuty == expected.startDuty);
+    TEST_ASSERT_TRUE(table.slope == expected.slope);
+    TEST_ASSERT_EQUAL_MEMORY(expected.first, table.first, sizeof(table.first));
+  }
+}
+
+void test_fade_step_converges()
+{
+  uint32_t duty = 0;
+  for (int i = 0; i < 600 && duty != LEVEL_MAX; i++)
+  {
+    duty = softwareFadeStep(duty, LEVEL_MAX);
+  }
+  TEST_ASSERT_EQUAL_UINT32(LEVEL_MAX, duty);
+}
+
+void test_parse_time_of_day()
+{
+  uint32_t second;
+  TEST_ASSERT_TRUE(parseTimeOfDay("06:30", second));
+  TEST_ASSERT_EQUAL_UINT32(6 * 3600 + 30 * 60, second);
+  TEST_ASSERT_TRUE(parseTimeOfDay("12:00:30", second));
+  TEST_ASSERT_EQUAL_UINT32(12 * 3600 + 30, second);
+  TEST_ASSERT_TRUE(parseTimeOfDay("24:00", second));
+  TEST_ASSERT_EQUAL_UINT32(SECONDS_PER_DAY, second);
+
+  const char *bad[] = {"12", "12:", "12::", "12:00abc", "12:00:", "12:00:30x", "24:01", "12:60",
+                       "-1:00", "4294967297:00", ""};
+  for (const char *text : bad)
+  {
+    TEST_ASSERT_FALSE_MESSAGE(parseTimeOfDay(text, second), text);
+  }
+}
+
+void test_blob_round_trip()
+{
+  std::vector<SchedulePoint> points = makePoints(10);
+  std::vector<uint8_t> blob = encodeScheduleBlob(points);
+
+  std::vector<SchedulePoint> decoded;
+  TEST_ASSERT_TRUE(decodeScheduleBlob(blob.data(), blob.size(), decoded));
+  TEST_ASSERT_EQUAL(points.size(), decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(points[3].time, decoded[3].time);
+  TEST_ASSERT_EQUAL_UINT16(points[3].duty, decoded[3].duty);
+
+  ScheduleBlobParser parser;
+  parser.reset();
+  parser.feed(blob.data(), blob.size());
+  TEST_ASSERT_TRUE(parser.finish());
+  TEST_ASSERT_EQUAL(points.size(), parser.points.size());
+
+  blob.back() ^= 1;
+  TEST_ASSERT_FALSE(decodeScheduleBlob(blob.data(), blob.size(), decoded));
+
+  // Both decoders cap the point count the same way
+  blob = encodeScheduleBlob(makePoints(MAX_SCHEDULE_POINTS + 1));
+  TEST_ASSERT_FALSE(decodeScheduleBlob(blob.data(), blob.size(), decoded));
+  parser.reset();
+  parser.feed(blob.data(), blob.size());
+  TEST_ASSERT_FALSE(parser.finish());
+}
+
+void test_blob_header_layout()
+{
+  // Built byte by byte as stored in NVS, so an encoder and decoder that
+  // agree on a wrong field order still fail
+  std::vector<SchedulePoint> points = {{3600, 5000}, {7200, 10000}};
+  std::vector<uint8_t> blob = encodeScheduleBlob(points);
+  TEST_ASSERT_EQUAL(10 + 2 * 4, blob.size());
+
+  uint8_t words[8];
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    uint32_t word = points[i].time | ((uint32_t)points[i].duty << 17);
+    for (int b = 0; b < 4; b++)
+    {
+      words[i * 4 + b] = word >> (8 * b);
+    }
+  }
+  uint32_t crc = scheduleCrc32(0, words, sizeof(words));
+  const uint8_t header[10] = {0x41, 0x54, SCHEDULE_BLOB_VERSION, 0, 2, 0,
+                              (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)};
+  TEST_ASSERT_EQUAL_MEMORY(header, blob.data(), sizeof(header));
+  TEST_ASSERT_EQUAL_MEMORY(words, blob.data() + sizeof(header), sizeof(words));
+
+  std::vector<uint8_t> stored(header, header + sizeof(header));
+  stored.insert(stored.end(), words, words + sizeof(words));
+  std::vector<SchedulePoint> decoded;
+  TEST_ASSERT_TRUE(decodeScheduleBlob(stored.data(), stored.size(), decoded));
+  TEST_ASSERT_EQUAL(2, decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(7200, decoded[1].time);
+  TEST_ASSERT_EQUAL_UINT16(10000, decoded[1].duty);
+}
+
+void test_crc_matches_zlib()
+{
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, scheduleCrc32(0, (const uint8_t *)"123456789", 9));
+}
+
+void test_json_round_trip()
+{
+  const char *json = "[{\"time\":\"06:30\",\"duty\":12.5},{\"time\":\"12:00:30\",\"duty\":100,\"note\":\"x\"}]";
+  ScheduleJsonParser parser;
+  parser.reset();
+  // Feed a byte at a time, as the slowest upload would arrive
+  for (const char *c = json; *c; c++)
+  {
+    parser.feed((const uint8_t *)c, 1);
+  }
+  TEST_ASSERT_TRUE(parser.finish());
+  TEST_ASSERT_EQUAL(2, parser.points.size());
+  TEST_ASSERT_EQUAL_UINT32(6 * 3600 + 30 * 60, parser.points[0].time);
+  TEST_ASSERT_EQUAL_UINT16(1250, parser.points[0].duty);
+
+  JsonDocument doc;
+  scheduleToJson(parser.points, doc.to<JsonArray>());
+  std::string out;
+  serializeJson(doc, out);
+  TEST_ASSERT_EQUAL_STRING("[{\"time\":\"06:30\",\"duty\":12.5},{\"time\":\"12:00:30\",\"duty\":100}]", out.c_str());
+}
+
+void test_json_rejects_invalid_duty()
+{
+  const char *bad[] = {"nan", "\"nan\"", "inf", "\"abc\"", "\"50xyz\"", "\"\""};
+  for (const char *duty : bad)
+  {
+    std::string json = std::string("[{\"time\":\"06:30\",\"duty\":") + duty + "}]";
+    ScheduleJsonParser parser;
+    parser.reset();
+    parser.feed((const uint8_t *)json.data(), json.size());
+    TEST_ASSERT_FALSE_MESSAGE(parser.finish(), duty);
+  }
+
+  uint16_t duty;
+  TEST_ASSERT_TRUE(parseDutyPercent("12.5", duty));
+  TEST_ASSERT_EQUAL_UINT16(1250, duty);
+  TEST_ASSERT_TRUE(parseDutyPercent("150", duty));
+  TEST_ASSERT_EQUAL_UINT16(10000, duty);
+  TEST_ASSERT_FALSE(parseDutyPercent("ON", duty));
+}
+
+void benchmark_lookups()
+{
+  const size_t SIZES[] = {1, 10, 100, 1000};
+  std::mt19937 random(1);
+  for (size_t size : SIZES)
+  {
+    ScheduleTable table;
+    compileOnChannel0(table, makePoints(size));
+
+    // Sequential seconds, as the PWM task walks the day: the cursor fast path
+    const int DAYS = 20;
+    auto start = std::chrono::steady_clock::now();
+    size_t cursor = 0;
+    uint32_t sum = 0;
+    for (int day = 0; day < DAYS; day++)
+    {
+      for (uint32_t second = 0; second < SECONDS_PER_DAY; second++)
+      {
+        sum += calculateCurrentLevel(table, 0, second, cursor);
+      }
+    }
+    double sequential = DAYS * SECONDS_PER_DAY / secondsSince(start);
+
+    // Random seconds, as status requests with a fresh cursor: the binary search
+    std::vector<uint32_t> seconds(1 << 16);
+    for (uint32_t &second : seconds)
+    {
+      second = random() % SECONDS_PER_DAY;
+    }
+    const int ROUNDS = 30;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++)
+    {
+      for (uint32_t second : seconds)
+      {
+        size_t fresh = 0;
+        sum += calculateCurrentLevel(table, 0, second, fresh);
+      }
+    }
+    double randomRate = ROUNDS * seconds.size() / secondsSince(start);
+    sink = sum;
+
+    char line[120];
+    snprintf(line, sizeof(line), "lookups, %4u points: %6.1f M/s sequential, %6.1f M/s random", (unsigned)size,
+             sequential / 1e6, randomRate / 1e6);
+    TEST_MESSAGE(line);
+  }
+}
+
+void benchmark_fade_step()
+{
+  const uint32_t STEPS = 50000000;
+  auto start = std::chrono::steady_clock::now();
+  uint32_t duty = 0;
+  for (uint32_t i = 0; i < STEPS; i++)
+  {
+    duty = softwareFadeStep(duty, (i & 0x400) ? LEVEL_MAX : 0);
+  }
+  double elapsed = secondsSince(start);
+  sink = duty;
+
+  char line[120];
+  snprintf(line, sizeof(line), "fade step: %.2f ns", elapsed * 1e9 / STEPS);
+  TEST_MESSAGE(line);
+}
+
+void benchmark_schedule_load()
+{
+  // The work loadScheduleFromPreferences() does per channel: decode the
+  // binary blob and recompile, plus the legacy JSON migration and the
+  // serialization behind GET /api/schedule
+  std::vector<SchedulePoint> points = makePoints(MAX_SCHEDULE_POINTS);
+  std::vector<uint8_t> blob = encodeScheduleBlob(points);
+  JsonDocument doc;
+  scheduleToJson(points, doc.to<JsonArray>());
+  std::string json;
+  serializeJson(doc, json);
+
+  const int ROUNDS = 200;
+  std::vector<SchedulePoint> decoded;
+  ScheduleTable table;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    decodeScheduleBlob(blob.data(), blob.size(), decoded);
+  }
+  double decodeUs = secondsSince(start) * 1e6 / ROUNDS;
+
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    compileOnChannel0(table, decoded);
+  }
+  double compileUs = secondsSince(start) * 1e6 / ROUNDS;
+
+  // A single point moved back and forth, against the full compile above
+  size_t index = points.size() / 2;
+  SchedulePoint moved[2] = {decoded[index], {decoded[index].time + 60, 5000}};
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    recompileCurveWindow(table, curveIndex(0, 0), decoded, updateSchedulePoint(decoded, index, moved[~round & 1]));
+  }
+  double editUs = secondsSince(start) * 1e6 / ROUNDS;
+
+  ScheduleJsonParser parser;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    parser.reset();
+    parser.feed((const uint8_t *)json.data(), json.size());
+    parser.finish();
+  }
+  double parseUs = secondsSince(start) * 1e6 / ROUNDS;
+  TEST_ASSERT_EQUAL(points.size(), parser.points.size());
+
+  start = std::chrono::steady_clock::now();
+  size_t length = 0;
+  for (int round = 0; round < ROUNDS; round++)
+  {
+    JsonDocument out;
+    scheduleToJson(points, out.to<JsonArray>());
+    std::string text;
+    length += serializeJson(out, text);
+  }
+  double serializeUs = secondsSince(start) * 1e6 / ROUNDS;
+  sink = length;
+
+  char line[200];
+  snprintf(line, sizeof(line),
+           "%u points: blob decode %.1f us, compile %.1f us, point edit %.2f us, JSON parse %.1f us (%u bytes), "
+           "JSON serialize %.1f us",
+           (unsigned)points.size(), decodeUs, compileUs, editUs, parseUs, (unsigned)json.size(), serializeUs);
+  TEST_MESSAGE(line);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_interpolates_between_points);
+  RUN_TEST(test_cursor_agrees_with_search);
+  RUN_TEST(test_profile_rules);
+  RUN_TEST(test_profile_rules_json);
+  RUN_TEST(test_solar_day);
+  RUN_TEST(test_point_edits_match_full_compile);
+  RUN_TEST(test_fade_step_converges);
+  RUN_TEST(test_parse_time_of_day);
+  RUN_TEST(test_blob_round_trip);
+  RUN_TEST(test_blob_header_layout);
+  RUN_TEST(test_crc_matches_zlib);
+  RUN_TEST(test_json_round_trip);
+  RUN_TEST(test_json_rejects_invalid_duty);
+  RUN_TEST(benchmark_lookups);
+  RUN_TEST(benchmark_fade_step);
+  RUN_TEST(benchmark_schedule_load);
+  return UNITY_END();
+}
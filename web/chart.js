@@ -0,0 +1,92 @@
+// Minimal canvas line chart for the light schedule: hours 0-24 on x,
+// duty 0-100 % on y, and an optional vertical marker (current time).
+// Replaces Chart.js so the dashboard works without internet access.
+function LightChart(canvas, options) {
+  this.canvas = canvas;
+  this.options = options || {};
+  this.data = [];
+  window.addEventListener('resize', () => this.update());
+}
+
+LightChart.prototype.update = function () {
+  const canvas = this.canvas;
+  const opts = this.options;
+  const ratio = window.devicePixelRatio || 1;
+  const width = canvas.clientWidth;
+  const height = canvas.clientHeight;
+  canvas.width = width * ratio;
+  canvas.height = height * ratio;
+
+  const ctx = canvas.getContext('2d');
+  ctx.setTransform(ratio, 0, 0, ratio, 0, 0);
+  ctx.clearRect(0, 0, width, height);
+  ctx.font = '12px Arial, sans-serif';
+
+  const area = { left: 50, top: 10, right: width - 15, bottom: height - 45 };
+  const xPixel = x => area.left + (x / 24) * (area.right - area.left);
+  const yPixel = y => area.bottom - (y / 100) * (area.bottom - area.top);
+
+  // Grid and tick labels
+  ctx.strokeStyle = '#e0e0e0';
+  ctx.fillStyle = '#666';
+  ctx.lineWidth = 1;
+  ctx.textAlign = 'center';
+  ctx.textBaseline = 'top';
+  for (let h = 0; h <= 24; h += 2) {
+    ctx.beginPath();
+    ctx.moveTo(xPixel(h), area.top);
+    ctx.lineTo(xPixel(h), area.bottom);
+    ctx.stroke();
+    ctx.fillText(h, xPixel(h), area.bottom + 5);
+  }
+  ctx.textAlign = 'right';
+  ctx.textBaseline = 'middle';
+  for (let d = 0; d <= 100; d += 20) {
+    ctx.beginPath();
+    ctx.moveTo(area.left, yPixel(d));
+    ctx.lineTo(area.right, yPixel(d));
+    ctx.stroke();
+    ctx.fillText(d, area.left - 6, yPixel(d));
+  }
+
+  // Axis titles
+  ctx.textAlign = 'center';
+  ctx.textBaseline = 'bottom';
+  if (opts.xTitle) ctx.fillText(opts.xTitle, (area.left + area.right) / 2, height - 5);
+  if (opts.yTitle) {
+    ctx.save();
+    ctx.translate(12, (area.top + area.bottom) / 2);
+    ctx.rotate(-Math.PI / 2);
+    ctx.textBaseline = 'middle';
+    ctx.fillText(opts.yTitle, 0, 0);
+    ctx.restore();
+  }
+
+  // Schedule line with the area below it filled
+  if (this.data.length > 0) {
+    ctx.beginPath();
+    this.data.forEach((p, i) => {
+      if (i === 0) ctx.moveTo(xPixel(p.x), yPixel(p.y));
+      else ctx.lineTo(xPixel(p.x), yPixel(p.y));
+    });
+    ctx.strokeStyle = 'rgb(0,150,255)';
+    ctx.lineWidth = 3;
+    ctx.stroke();
+    ctx.lineTo(xPixel(this.data[this.data.length - 1].x), area.bottom);
+    ctx.lineTo(xPixel(this.data[0].x), area.bottom);
+    ctx.closePath();
+    ctx.fillStyle = 'rgba(0,150,255,0.1)';
+    ctx.fill();
+  }
+
+  // Marker line
+  if (opts.marker) {
+    const x = xPixel(opts.marker());
+    ctx.beginPath();
+    ctx.moveTo(x, area.top);
+    ctx.lineTo(x, area.bottom);
+    ctx.lineWidth = 2;
+    ctx.strokeStyle = 'red';
+    ctx.stroke();
+  }
+};